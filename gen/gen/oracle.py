@@ -0,0 +1,154 @@
+"""Differential oracle: diff kasa's output against the reference semantics of TicketOffice.
+
+Ticket sets are compared by total price rather than verbatim, since equally cheap sets may be chosen differently;
+kasa's set is verified to cover the route on its own, and its final counter to agree with the sets it printed.
+
+Where TicketOffice knowingly diverges from kasa's spec, it is adapted to the latter:
+- an improper route (unknown line, stop off the line, stops in reverse order, missed connection) is answered with
+  ":-|", whereas TicketOffice reports an error (or raises KeyError for an unknown line), and only once the whole route
+  is known to be proper may waiting be reported (TicketOffice stops checking at the first wait);
+- a duplicate ticket id is an error, whereas TicketOffice accepts it.
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+from .ticket_office import TicketOffice
+from .workload import Workload
+
+# Size of the generated samples; kept small, as the reference enumerates all ticket sets and scans all tramlines.
+SAMPLE_SIZE = {"lines": 40, "tickets": 10, "queries": 300}
+# Shape of the generated samples.
+SAMPLE = {**SAMPLE_SIZE, "stops_per_line": 12, "malformed": 0.02, "invalid": 0.1}
+SHAPES = {
+    "default": SAMPLE,
+    # Lines spanning several of kasa's 16-stop blocks, with stop numbers beyond a single varint byte and beyond the
+    # 64 bits of a block's stop filter.
+    "blocks": {**SAMPLE, "stops_per_line": 40, "stops": 160},
+}
+
+
+def proper_route(office, request):
+    """Check the whole route with TicketOffice.verify_seq, including the part past the first wait.
+
+    verify_seq returns at the first wait, so it is run on every pair of consecutive legs (or on the single leg): each
+    of them checks both legs and the connection in between, and together they cover the whole route.
+    """
+    seq = request.split(" ")[1:]
+    for i in range(0, max(len(seq) - 4, 1), 2):
+        try:
+            office.verify_seq(seq[i:i + 5])
+        except (ValueError, KeyError):
+            return False
+    return True
+
+
+def run_reference(requests):
+    office = TicketOffice()
+    ticket_ids = set()
+    out, err, origins = [], [], []
+    for i, request in enumerate(requests, 1):
+        ticket_match = re.match(TicketOffice.ticket_add_re, request)
+        if ticket_match and ticket_match.group("id") in ticket_ids:
+            status, res = False, None
+        elif re.match(TicketOffice.ticket_query_re, request) and not proper_route(office, request):
+            status, res = True, ":-|"
+        else:
+            status, res = office.process(request)
+        if ticket_match and status:
+            ticket_ids.add(ticket_match.group("id"))
+        if res:
+            out += res,
+            origins += request,
+        if not status:
+            err += f"Error in line {i}: {request}",
+    out += str(office.counter),
+    return office, out, err, origins
+
+
+def run_kasa(kasa, requests):
+    proc = subprocess.run([kasa], input="".join(f"{request}\n" for request in requests), capture_output=True,
+                          text=True, check=True)
+    return proc.stdout.splitlines(), proc.stderr.splitlines()
+
+
+def ticket_ids(answer):
+    return [ticket_id.strip() for ticket_id in answer[1:].split(";") if ticket_id.strip()]
+
+
+def diff(requests, kasa_out, kasa_err, office, ref_out, ref_err, origins):
+    """Return the list of human-readable discrepancies (empty iff kasa agrees with the reference)."""
+    mismatches = []
+    if kasa_err != ref_err:
+        mismatches += f"stderr differs: kasa {kasa_err[:5]}..., reference {ref_err[:5]}...",
+    if len(kasa_out) != len(ref_out):
+        return mismatches + [f"stdout has {len(kasa_out)} lines, reference has {len(ref_out)}"]
+
+    tickets = {ticket_id.strip(): (round(price * 100), dur) for ticket_id, (price, dur) in office.tickets[1].items()}
+    sold = 0
+
+    for got, expected, request in zip(kasa_out, ref_out, origins):
+        if not (got.startswith("!") and expected.startswith("!")):
+            if got != expected:
+                mismatches += f"{request!r}: kasa {got!r}, reference {expected!r}",
+            continue
+
+        got_ids, expected_ids = ticket_ids(got), ticket_ids(expected)
+        sold += len(got_ids)
+        if not (0 < len(got_ids) <= 3 and all(ticket_id in tickets for ticket_id in got_ids)):
+            mismatches += f"{request!r}: kasa sold an improper ticket set {got!r}",
+            continue
+
+        seq = request.split(" ")[1:]
+        _, start = office.lines[seq[1]][seq[0]]
+        _, end = office.lines[seq[-2]][seq[-1]]
+        if sum(tickets[ticket_id][1] for ticket_id in got_ids) < end.ord() - start.ord() + 1:
+            mismatches += f"{request!r}: kasa's tickets {got!r} do not cover the route",
+        if sum(tickets[ticket_id][0] for ticket_id in got_ids) != \
+                sum(tickets[ticket_id][0] for ticket_id in expected_ids):
+            mismatches += f"{request!r}: kasa {got!r} not priced as reference {expected!r}",
+
+    if kasa_out[-1] != str(sold):
+        mismatches += f"counter: kasa {kasa_out[-1]}, but it sold {sold} tickets",
+    return mismatches
+
+
+def check(kasa, requests):
+    kasa_out, kasa_err = run_kasa(kasa, requests)
+    return diff(requests, kasa_out, kasa_err, *run_reference(requests))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Diff kasa against the reference ticket office.")
+    parser.add_argument("--kasa", required=True, help="path to the kasa executable")
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--seed", type=int, help="check on a generated sample with this seed")
+    source.add_argument("--input", help="check on the requests from this file")
+    parser.add_argument("--shape", choices=sorted(SHAPES), default="default", help="shape of the generated sample")
+    parser.add_argument("--expected-out", help="additionally require kasa's stdout to match this file verbatim")
+    parser.add_argument("--expected-err", help="additionally require kasa's stderr to match this file verbatim")
+    args = parser.parse_args()
+
+    if args.input:
+        with open(args.input) as f:
+            requests = f.read().splitlines()
+    else:
+        requests = Workload(args.seed, **SHAPES[args.shape]).requests()
+
+    kasa_out, kasa_err = run_kasa(args.kasa, requests)
+    mismatches = diff(requests, kasa_out, kasa_err, *run_reference(requests))
+    for name, got in [(args.expected_out, kasa_out), (args.expected_err, kasa_err)]:
+        if name:
+            with open(name) as f:
+                if f.read().splitlines() != got:
+                    mismatches += f"output differs from {name}",
+
+    for mismatch in mismatches[:20]:
+        sys.stderr.write(f"{mismatch}\n")
+    sys.stdout.write(f"{len(requests)} requests, {len(mismatches)} mismatches\n")
+    return 1 if mismatches else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,109 @@
+"""Performance regression check of kasa on large generated workloads.
+
+Throughput (requests per second, best of several runs) and peak RSS are compared against checked-in baselines and a
+regression beyond the tolerance fails the check. Before measuring, kasa's answers are diffed against the reference
+TicketOffice on a small sample of the same shape, so that a faster kasa may not answer differently.
+
+Baselines are recorded per build type, as an unoptimized kasa is several times slower; a build type with no baseline
+fails the check. They are also machine-specific; after an intended change (or on a new machine) refresh them with
+--update. Workloads are sized for runs of a couple of seconds even in an optimized build, so that timings are stable.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+from . import oracle
+from .workload import Workload
+
+WORKLOADS = {
+    # Many long tramlines, few queries: dominated by tramline parsing and storage.
+    "line_heavy": {"lines": 12000, "stops_per_line": 40, "stops": 400, "tickets": 20, "queries": 8000,
+                   "invalid": 0.05},
+    # A modest network under heavy querying: dominated by route verification and ticket search.
+    "query_heavy": {"lines": 300, "stops_per_line": 20, "tickets": 30, "queries": 40000, "max_legs": 4,
+                    "invalid": 0.05},
+}
+
+
+def measure(probe, kasa, path):
+    """Run kasa on the requests in path through the probe; return wall time in seconds and peak RSS in KiB.
+
+    The probe (rss_probe.cc) must be a separate tiny process: peak RSS also covers the memory a process had before
+    exec, so kasa spawned directly from this one (or from any interpreter) would report at least that much.
+    """
+    with open(path) as f:
+        result = subprocess.run([probe, kasa], stdin=f, capture_output=True, text=True, check=True)
+    returncode, elapsed, peak_rss_kb = result.stdout.split()
+    if int(returncode) != 0:
+        raise RuntimeError(f"kasa exited with {returncode}")
+    return float(elapsed), int(peak_rss_kb)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Check kasa's performance against the baselines.")
+    parser.add_argument("--kasa", required=True, help="path to the kasa executable")
+    parser.add_argument("--probe", required=True, help="path to the rss_probe executable")
+    parser.add_argument("--workload", required=True, choices=sorted(WORKLOADS))
+    parser.add_argument("--baselines", required=True, help="path to the JSON file with baselines")
+    parser.add_argument("--build-type", default="", help="CMake build type of kasa (baselines are kept per build type)")
+    parser.add_argument("--tolerance", type=float, default=0.25, help="allowed relative regression")
+    parser.add_argument("--runs", type=int, default=3, help="number of timed runs")
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--update", action="store_true", help="record the measurements as the new baseline")
+    args = parser.parse_args()
+
+    spec = WORKLOADS[args.workload]
+
+    # The sample keeps the shape of the workload (e.g. its line length), only its size is that of oracle's samples.
+    mismatches = oracle.check(args.kasa, Workload(args.seed, **{**spec, **oracle.SAMPLE_SIZE}).requests())
+    for mismatch in mismatches[:20]:
+        sys.stderr.write(f"{mismatch}\n")
+    if mismatches:
+        sys.stdout.write(f"{args.workload}: {len(mismatches)} mismatches against the reference\n")
+        return 1
+
+    requests = Workload(args.seed, **spec).requests()
+    with tempfile.NamedTemporaryFile("w", suffix=".in") as f:
+        f.write("".join(f"{request}\n" for request in requests))
+        f.flush()
+        runs = [measure(args.probe, args.kasa, f.name) for _ in range(args.runs)]
+
+    throughput = round(len(requests) / min(elapsed for elapsed, _ in runs))
+    peak_rss_kb = max(rss for _, rss in runs)
+    build_type = args.build_type or "None"
+    sys.stdout.write(f"{args.workload} ({build_type}): {len(requests)} requests, {throughput} requests/s, "
+                     f"{peak_rss_kb} KiB peak RSS\n")
+
+    baselines = {}
+    if os.path.exists(args.baselines):
+        with open(args.baselines) as f:
+            baselines = json.load(f)
+
+    if args.update:
+        baselines.setdefault(build_type, {})[args.workload] = {"requests_per_second": throughput,
+                                                              "peak_rss_kb": peak_rss_kb}
+        with open(args.baselines, "w") as f:
+            json.dump(baselines, f, indent=4, sort_keys=True)
+            f.write("\n")
+        return 0
+
+    if args.workload not in baselines.get(build_type, {}):
+        sys.stdout.write(f"{args.workload}: no baseline recorded for build type {build_type}, run with --update\n")
+        return 1
+
+    baseline = baselines[build_type][args.workload]
+    failed = False
+    if throughput < (1 - args.tolerance) * baseline["requests_per_second"]:
+        sys.stdout.write(f"{args.workload}: throughput regressed from {baseline['requests_per_second']} requests/s\n")
+        failed = True
+    if peak_rss_kb > (1 + args.tolerance) * baseline["peak_rss_kb"]:
+        sys.stdout.write(f"{args.workload}: peak RSS regressed from {baseline['peak_rss_kb']} KiB\n")
+        failed = True
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,166 @@
+import random
+from .clock_time import ClockTime
+from .name_generator import NameGenerator as NG
+
+
+class Workload:
+    """Deterministic generator of kasa requests.
+
+    Tramlines are always causal and within the operation range. A share of invalid requests may be mixed in: improper
+    routes (unknown line, stop off the line, stops in reverse order, missed connection), duplicate tramline and ticket
+    ids and tramlines with a repeated stop. Malformed requests, if any, are rejected by the request regexes alone.
+    """
+
+    office_start = ClockTime.from_numbers(5, 55)
+    office_end = ClockTime.from_numbers(21, 21)
+
+    def __init__(self, seed, lines, stops_per_line, tickets, queries, stops=None, max_legs=3, malformed=0.0,
+                 invalid=0.0, time_step=5):
+        self.rng = random.Random(seed)
+        self.lines = lines
+        self.stops_per_line = stops_per_line
+        self.tickets = tickets
+        self.queries = queries
+        self.stops = stops or 2 * stops_per_line
+        self.max_legs = max_legs
+        self.malformed = malformed
+        self.invalid = invalid
+        # Coarse time slots make connections without waiting reasonably frequent.
+        self.time_slots = list(range(self.office_start.ord(), self.office_end.ord() + 1, time_step))
+
+    def gen_name(self, chars, id_len):
+        return "".join(self.rng.choices(chars, k=id_len))
+
+    def gen_unique(self, count, gen):
+        names = set()
+        while len(names) < count:
+            names.add(gen())
+        return sorted(names)
+
+    def gen_ticket_id(self):
+        head = self.gen_name(NG.ticket_id_chars.strip(), self.rng.randint(3, 8))
+        tail = self.gen_name(NG.ticket_id_chars.strip(), self.rng.randint(0, 6))
+        return f"{head} {tail}" if tail else head
+
+    def gen_line_id(self, taken):
+        while True:
+            line_id = str(self.rng.randrange(1, 10 ** 9))
+            if line_id not in taken:
+                return line_id
+
+    def gen_stops(self, stop_ids):
+        stops = self.rng.sample(stop_ids, self.stops_per_line)
+        times = sorted(self.rng.sample(self.time_slots, self.stops_per_line))
+        return list(zip(times, stops))
+
+    def format_line(self, line_id, stops):
+        return f"{line_id} " + " ".join(f"{ClockTime.from_ordinal(time)} {stop}" for time, stop in stops)
+
+    def format_ticket(self, ticket_id):
+        cents = self.rng.randint(1, 9999)
+        dur = self.rng.randint(5, 240)
+        return f"{ticket_id} {cents // 100}.{cents % 100:02d} {dur}"
+
+    def gen_route(self, lines, line_ids, departures, missed=False):
+        """Return a route as [stop, line, stop, ...]; with missed, its first connection departs before we arrive."""
+        line_id = self.rng.choice(line_ids)
+        start_ix = self.rng.randrange(len(lines[line_id]) - 1)
+        seq = [lines[line_id][start_ix][1]]
+
+        for leg in range(self.rng.randint(2 if missed else 1, self.max_legs)):
+            end_ix = self.rng.randrange(start_ix + 1, len(lines[line_id]))
+            arrival, stop = lines[line_id][end_ix]
+            seq += line_id, stop
+
+            # Continue on some line departing from this stop no earlier than we arrive; prefer ones we need not
+            # wait for, so that the answers are not dominated by waiting.
+            if missed and leg == 0:
+                options = [(ix, time, other) for ix, time, other in departures.get(stop, []) if time < arrival]
+                exact = []
+            else:
+                options = [(ix, time, other) for ix, time, other in departures.get(stop, []) if time >= arrival]
+                exact = [option for option in options if option[1] == arrival]
+            if not options:
+                break
+            start_ix, _, line_id = self.rng.choice(exact if exact and self.rng.random() < 0.5 else options)
+
+        return seq
+
+    def gen_query(self, lines, line_ids, departures):
+        return "? " + " ".join(self.gen_route(lines, line_ids, departures))
+
+    def gen_improper_query(self, lines, line_ids, departures, stop_ids):
+        kind = self.rng.choice(["unknown line", "stop off line", "reverse order", "missed connection"])
+
+        if kind == "reverse order":
+            # A single leg, so that nothing but the order is wrong; the stops may also coincide.
+            line_id = self.rng.choice(line_ids)
+            start_ix = self.rng.randrange(len(lines[line_id]))
+            end_ix = self.rng.randrange(start_ix + 1)
+            return f"? {lines[line_id][start_ix][1]} {line_id} {lines[line_id][end_ix][1]}"
+
+        if kind == "missed connection":
+            # Not every stop has an earlier departure, so retry until the route has one indeed (or give up on it).
+            for _ in range(100):
+                seq = self.gen_route(lines, line_ids, departures, missed=True)
+                if len(seq) >= 5:
+                    return "? " + " ".join(seq)
+            kind = "unknown line"
+
+        seq = self.gen_route(lines, line_ids, departures)
+        leg = self.rng.randrange(len(seq) // 2)
+        if kind == "unknown line":
+            seq[2 * leg + 1] = self.gen_line_id(lines)
+        else:
+            on_line = {stop for _, stop in lines[seq[2 * leg + 1]]}
+            seq[2 * leg + 2] = self.rng.choice([stop for stop in stop_ids if stop not in on_line])
+        return "? " + " ".join(seq)
+
+    def gen_invalid_addition(self, lines, stop_ids, ticket_ids):
+        kind = self.rng.choice(["duplicate line", "repeated stop", "duplicate ticket"])
+
+        if kind == "duplicate line":
+            return self.format_line(self.rng.choice(list(lines)), self.gen_stops(stop_ids))
+        if kind == "repeated stop":
+            stops = self.gen_stops(stop_ids)
+            first, second = sorted(self.rng.sample(range(len(stops)), 2))
+            stops[second] = stops[second][0], stops[first][1]
+            return self.format_line(self.gen_line_id(lines), stops)
+        return self.format_ticket(self.rng.choice(ticket_ids))
+
+    def gen_malformed(self):
+        return self.rng.choice([
+            f"{self.gen_ticket_id()} 1.234 5",
+            f"{self.rng.randrange(1, 10 ** 9)} 7:00 St0p",
+            f"? {self.gen_name(NG.stop_id_chars, 8)}",
+        ])
+
+    def requests(self):
+        stop_ids = self.gen_unique(self.stops, lambda: self.gen_name(NG.stop_id_chars, 8))
+        line_ids = self.gen_unique(self.lines, lambda: str(self.rng.randrange(1, 10 ** 9)))
+        self.rng.shuffle(line_ids)
+        lines = {line_id: self.gen_stops(stop_ids) for line_id in line_ids}
+        ticket_ids = self.gen_unique(self.tickets, self.gen_ticket_id)
+
+        # For each stop, record lines departing from it (i.e. containing it anywhere but at the end).
+        departures = {}
+        for line_id, stops in lines.items():
+            for ix, (time, stop) in enumerate(stops[:-1]):
+                departures.setdefault(stop, []).append((ix, time, line_id))
+
+        requests = [self.format_line(line_id, stops) for line_id, stops in lines.items()]
+        tickets = [self.format_ticket(ticket_id) for ticket_id in ticket_ids]
+        self.rng.shuffle(tickets)
+        requests += tickets
+        requests += [self.gen_improper_query(lines, line_ids, departures, stop_ids) if self.rng.random() < self.invalid
+                     else self.gen_query(lines, line_ids, departures) for _ in range(self.queries)]
+
+        # Invalid additions go among the queries, i.e. after the tramlines and tickets they duplicate.
+        additions = len(requests) - self.queries
+        for _ in range(int(self.invalid * additions)):
+            requests.insert(self.rng.randrange(additions, len(requests) + 1),
+                            self.gen_invalid_addition(lines, stop_ids, ticket_ids))
+
+        for _ in range(int(self.malformed * len(requests))):
+            requests.insert(self.rng.randrange(len(requests) + 1), self.gen_malformed())
+        return requests
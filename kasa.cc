@@ -10,6 +10,7 @@
 #include <unordered_set>
 #include <fstream>
 #include <variant>
+#include <vector>
 
 // An alias for all subsequent exceptions related to the operation of ticket office.
 using ticket_office_exn = std::invalid_argument;
@@ -97,15 +98,120 @@ stop_time_t stop_time_from_string(const std::string& str) {
     return stop_time;
 }
 
-// A representation of tramline: map from stop ids to <index, stop time> tuples
+// Conversion between clock time and its ordinal, i.e. the number of minutes since midnight.
+clock_nat_t stop_time_to_ordinal(const stop_time_t& stop_time) noexcept {
+    const auto& [hour, minute] = stop_time;
+    return static_cast<clock_nat_t>(60 * hour + minute);
+}
+
+stop_time_t stop_time_from_ordinal(const clock_nat_t& ordinal) noexcept {
+    return stop_time_t(ordinal / 60, ordinal % 60);
+}
+
+// Append the unsigned LEB128 encoding (7 bits per byte, high bit marking continuation) of num to bytes.
+void encode_varint(uint64_t num, std::vector<uint8_t>& bytes) {
+    while (num >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(num | 0x80));
+        num >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(num));
+}
+
+// Decode the unsigned LEB128 number starting at pos, and advance pos past it.
+uint64_t decode_varint(const std::vector<uint8_t>& bytes, size_t& pos) noexcept {
+    uint64_t num = 0;
+    for (unsigned shift = 0; ; shift += 7) {
+        const auto& byte = bytes[pos++];
+        num |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return num;
+        }
+    }
+}
+
+// Stop ids are interned, i.e. each distinct one is stored once and referred to by its consecutive number.
 using stop_id_t = std::string;
+using stop_num_t = uint32_t;
+using stop_nums_t = std::unordered_map<stop_id_t, stop_num_t>;
+
+// A representation of tramline, compressed as to fit large networks: a byte sequence of <stop number, time delta>
+// varint pairs, where the delta is in minutes from the prior stop (from midnight for the first one), and as such is
+// small and positive due to the causal order of stops. The sequence is split into blocks of stops_per_block stops,
+// each indexed by its byte offset, the ordinal time prior to it and a bit filter of its stop numbers, so that finding
+// a stop only decodes the blocks which may contain it.
 using seq_index_t = size_t;
 enum { _seq_index = 0, _stop_time = 1 };
-using tramline_t = std::unordered_map<stop_id_t, std::tuple<seq_index_t, stop_time_t>>;
+using stop_entry_t = std::tuple<seq_index_t, stop_time_t>;
+using byte_offset_t = uint32_t;
+using stop_filter_t = uint64_t;
+enum { _byte_offset = 0, _base_time = 1, _stop_filter = 2 };
+using block_t = std::tuple<byte_offset_t, clock_nat_t, stop_filter_t>;
+enum { _bytes = 0, _blocks = 1 };
+using tramline_t = std::tuple<std::vector<uint8_t>, std::vector<block_t>>;
+
+constexpr seq_index_t stops_per_block = 16;
+
+// The bit of block's filter which is set iff the block may contain the stop.
+stop_filter_t stop_filter_bit(const stop_num_t& stop_num) noexcept {
+    return stop_filter_t(1) << (stop_num % std::numeric_limits<stop_filter_t>::digits);
+}
 
-// A representation of tramlines container: map from tramline ids to tramline objects proper
+// Compress the sequence of <stop number, stop time> tuples, which must be in causal order, into a tramline.
+tramline_t encode_tramline(const std::vector<std::tuple<stop_num_t, stop_time_t>>& stops) {
+    tramline_t tramline = {};
+    auto& [bytes, blocks] = tramline;
+    clock_nat_t prior_time = 0;
+
+    for (seq_index_t idx = 0; idx < stops.size(); ++idx) {
+        const auto& [stop_num, stop_time] = stops[idx];
+        if (idx % stops_per_block == 0) {
+            blocks.emplace_back(static_cast<byte_offset_t>(bytes.size()), prior_time, 0);
+        }
+        std::get<_stop_filter>(blocks.back()) |= stop_filter_bit(stop_num);
+
+        const auto time = stop_time_to_ordinal(stop_time);
+        encode_varint(stop_num, bytes);
+        encode_varint(time - prior_time, bytes);
+        prior_time = time;
+    }
+
+    // The tramline is never modified afterwards, so any spare capacity would be wasted.
+    bytes.shrink_to_fit();
+    blocks.shrink_to_fit();
+    return tramline;
+}
+
+// Find the sequence index and stop time of the stop in the tramline (or nullopt if the tramline does not contain it).
+std::optional<stop_entry_t> find_stop(const tramline_t& tramline, const stop_num_t& stop_num) noexcept {
+    const auto& [bytes, blocks] = tramline;
+
+    for (size_t block_idx = 0; block_idx < blocks.size(); ++block_idx) {
+        const auto& [offset, base_time, filter] = blocks[block_idx];
+        if (!(filter & stop_filter_bit(stop_num))) {
+            continue;
+        }
+
+        // Decode the block up to the start of the next one, accumulating the time deltas.
+        const size_t end = block_idx + 1 < blocks.size() ? std::get<_byte_offset>(blocks[block_idx + 1])
+                                                         : bytes.size();
+        size_t pos = offset;
+        clock_nat_t time = base_time;
+        for (seq_index_t idx = block_idx * stops_per_block; pos < end; ++idx) {
+            const auto num = decode_varint(bytes, pos);
+            time = static_cast<clock_nat_t>(time + decode_varint(bytes, pos));
+            if (num == stop_num) {
+                return std::make_optional<stop_entry_t>(idx, stop_time_from_ordinal(time));
+            }
+        }
+    }
+
+    return std::nullopt;
+}
+
+// A representation of tramlines container: interned stop ids and map from tramline ids to tramline objects proper
 using tramline_id_t = uint64_t;
-using tramlines_t = std::unordered_map<tramline_id_t, tramline_t>;
+enum { _stop_nums = 0, _lines = 1 };
+using tramlines_t = std::tuple<stop_nums_t, std::unordered_map<tramline_id_t, tramline_t>>;
 
 // A representation of tickets container: set of id's (for uniqueness tracking) and map from prices to <dur, id> tuples.
 using ticket_price_t = uint64_t;
@@ -131,6 +237,8 @@ using state_t = std::tuple<tramlines_t, tickets_t, counter_t>;
 
 // Add tramline as encoded in line to the tramlines container.
 void process_tramline_addition(const std::string& line, tramlines_t& tramlines) {
+    auto& [stop_nums, lines] = tramlines;
+
     // We shall use stringstream for token parsing.
     std::stringstream ss {};
     ss << line;
@@ -138,15 +246,16 @@ void process_tramline_addition(const std::string& line, tramlines_t& tramlines)
     // Retrieve id and verify if it's unique.
     tramline_id_t id;
     ss >> id;
-    if (tramlines.find(id) != tramlines.end()) {
+    if (lines.find(id) != lines.end()) {
         throw ticket_office_exn("tramline with specified id already exists");
     }
 
-    // Retrieve subsequent line stops.
-    tramline_t tram_line = {};
+    // Retrieve subsequent line stops; they are interned only once the whole tramline proves correct.
+    std::vector<std::tuple<stop_id_t, stop_time_t>> stops = {};
+    std::unordered_set<stop_id_t> stop_ids = {};
     auto prior_time = std::optional<stop_time_t>();
 
-    for (size_t idx = 0; ss.rdbuf()->in_avail() > 0; ++idx) {
+    while (ss.rdbuf()->in_avail() > 0) {
         // Retrieve stop time and stop id.
         std::string time_str;
         ss >> time_str;
@@ -157,15 +266,23 @@ void process_tramline_addition(const std::string& line, tramlines_t& tramlines)
         if (prior_time.has_value() && prior_time.value() >= stop_time) {
             throw ticket_office_exn("stops not in causal order");
         }
-        if (tram_line.find(stop_id) != tram_line.end()) {
+        if (!stop_ids.insert(stop_id).second) {
             throw ticket_office_exn("some stop repeated");
         }
 
         prior_time = std::make_optional(stop_time);
-        tram_line[stop_id] = {idx, stop_time};
+        stops.emplace_back(std::move(stop_id), stop_time);
     }
 
-    tramlines[id] = tram_line;
+    std::vector<std::tuple<stop_num_t, stop_time_t>> stop_nums_seq;
+    stop_nums_seq.reserve(stops.size());
+    for (auto& [stop_id, stop_time] : stops) {
+        const auto next_num = static_cast<stop_num_t>(stop_nums.size());
+        const auto& stop_num = stop_nums.try_emplace(std::move(stop_id), next_num).first->second;
+        stop_nums_seq.emplace_back(stop_num, stop_time);
+    }
+
+    lines[id] = encode_tramline(stop_nums_seq);
 }
 
 // Add a new ticket to tickets container, given the appropriate match.
@@ -193,6 +310,8 @@ void process_ticket_addition(const std::smatch& m, tickets_t& tickets) {
     if (ids.find(id) != ids.end()) {
         throw ticket_office_exn("ticket with specified id already exists");
     } else {
+        // The id is taken even if the ticket itself turns out to be dominated by a prior one.
+        ids.insert(id);
         // Since the structure of our container has prices as keys, we must distinguish (non-)presence.
         if (price_map.find(price) != price_map.end()) {
             auto &cur = price_map.at(price);
@@ -230,8 +349,8 @@ std::optional<branch_state_t> find_ticket_set(const ticket_dur_t& dur, const pri
             // In this case we may as well merely verify if the branch is optimal and not branch off further, as no
             // further improvement is possible, since prices are non-negative and necessary conditions are satisfied.
             if (total_dur >= dur) {
-                if (optimal.has_value()) optimal.value() = min(optimal.value(), branch);
-                else optimal = std::make_optional(branch);
+                // Notice that std::min would pick std::tuple's lexicographic operator< rather than ours.
+                if (!optimal.has_value() || branch < optimal.value()) optimal = std::make_optional(branch);
             }
         }        
         else {
@@ -294,33 +413,51 @@ std::tuple<std::vector<stop_id_t>, std::vector<tramline_id_t>> extract_query_dat
     return std::make_tuple(stops_seq, lines_seq);
 }
 
-// Verify whether the proposed route is proper structurally.
-bool verify_if_proper_route(const std::vector<stop_id_t>& stops_seq, const std::vector<tramline_id_t>& lines_seq,
-        const tramlines_t& tramlines) {
-    auto last_arrival_time = std::optional<stop_time_t>();
+// A leg of route: departure and arrival times.
+enum { _departure_time = 0, _arrival_time = 1 };
+using leg_t = std::tuple<stop_time_t, stop_time_t>;
+
+// Locate the legs of the proposed route directly in the compressed tramlines, provided that its every leg is proper
+// structurally (otherwise return nullopt).
+std::optional<std::vector<leg_t>> locate_route_legs(const std::vector<stop_id_t>& stops_seq,
+        const std::vector<tramline_id_t>& lines_seq, const tramlines_t& tramlines) {
+    const auto& [stop_nums, lines] = tramlines;
+    std::vector<leg_t> legs;
+    legs.reserve(lines_seq.size());
 
     for (size_t i = 0; i < lines_seq.size(); ++i) {
-        const auto &start_stop = stops_seq.at(i), &end_stop = stops_seq.at(i+1);
-        if (tramlines.find(lines_seq[i]) == tramlines.end()) {
-            return false;
+        const auto line_it = lines.find(lines_seq[i]);
+        const auto start_num_it = stop_nums.find(stops_seq.at(i)), end_num_it = stop_nums.find(stops_seq.at(i+1));
+        // Stops never seen in any tramline cannot be contained in this one.
+        if (line_it == lines.end() || start_num_it == stop_nums.end() || end_num_it == stop_nums.end()) {
+            return std::nullopt;
         }
-        const auto& tramline = tramlines.at(lines_seq[i]);
 
         // If line does not even contain the specified stops, the seq is improper.
-        if (tramline.find(start_stop) == tramline.end() || tramline.find(end_stop) == tramline.end()) {
-            return false;
+        const auto start = find_stop(line_it->second, start_num_it->second),
+                end = find_stop(line_it->second, end_num_it->second);
+        if (!start.has_value() || !end.has_value()) {
+            return std::nullopt;
         }
 
-        // Due to previous break, start and end exist (i.e. at will not throw std::out_of_range)
-        const auto& start = tramline.at(start_stop), end = tramline.at(end_stop);
-        const auto& [start_seq_idx, start_time] = start;
-        const auto& [end_seq_idx, end_time] = end;
+        const auto& [start_seq_idx, start_time] = start.value();
+        const auto& [end_seq_idx, end_time] = end.value();
 
         // If stops are not in order, the seq is improper.
         if (start_seq_idx >= end_seq_idx) {
-            return false;
+            return std::nullopt;
         }
+        legs.emplace_back(start_time, end_time);
+    }
 
+    return std::make_optional(legs);
+}
+
+// Verify whether the located route is proper, i.e. whether no connection is missed.
+bool verify_if_proper_route(const std::vector<leg_t>& legs) {
+    auto last_arrival_time = std::optional<stop_time_t>();
+
+    for (const auto& [start_time, end_time] : legs) {
         if (last_arrival_time.has_value()) {
             const auto& last_arrival = last_arrival_time.value();
             // In this case we arrive too late, so sequence is incorrect.
@@ -337,25 +474,19 @@ bool verify_if_proper_route(const std::vector<stop_id_t>& stops_seq, const std::
 
 // Verify whether the specified route entails waiting.
 std::optional<stop_id_t> verify_if_has_to_wait(const std::vector<stop_id_t>& stops_seq,
-        const std::vector<tramline_id_t>& lines_seq, const tramlines_t& tramlines) {
+        const std::vector<leg_t>& legs) {
     auto last_arrival_time = std::optional<stop_time_t>(std::nullopt);
 
-    for (size_t i = 0; i < lines_seq.size(); ++i) {
-        const auto &start_stop = stops_seq[i], &end_stop = stops_seq[i+1];
-        const auto& tramline = tramlines.at(lines_seq[i]);
-
-        // We need not worry about std::out_of_range, since the seq is proper
-        const auto& start = tramline.at(start_stop), end = tramline.at(end_stop);
-        const auto& [start_seq_idx, start_time] = start;
-        const auto& [end_seq_idx, end_time] = end;
+    for (size_t i = 0; i < legs.size(); ++i) {
+        const auto& [start_time, end_time] = legs[i];
 
         if (last_arrival_time.has_value()) {
             // If last arrival time was recorded (i.e. if this is not first iteration of loop), we must check if we
             // would not perhaps have to wait for the next one.
             const auto& last_arrival = last_arrival_time.value();
-            if (last_arrival > start_time) {
+            if (last_arrival < start_time) {
                 // Here, if so befalls, we would have to wait, and thus return the appropriate stop id.
-                return std::make_optional<stop_id_t>(start_stop);
+                return std::make_optional<stop_id_t>(stops_seq[i]);
             }
         }
         last_arrival_time = std::make_optional(end_time);
@@ -385,12 +516,14 @@ void process_route_query(const std::string& line, state_t& state) {
     auto [stops_seq, lines_seq] = extract_query_data(line);
 
     // After retrieving the tokens, we must verify the correctness.
-    if (!verify_if_proper_route(stops_seq, lines_seq, tramlines)) {
+    auto legs_opt = locate_route_legs(stops_seq, lines_seq, tramlines);
+    if (!legs_opt.has_value() || !verify_if_proper_route(legs_opt.value())) {
         std::cout << ":-|" << '\n';
         return;
     }
+    const auto& legs = legs_opt.value();
 
-    auto wait_stop_id_opt = verify_if_has_to_wait(stops_seq, lines_seq, tramlines);
+    auto wait_stop_id_opt = verify_if_has_to_wait(stops_seq, legs);
     if (wait_stop_id_opt.has_value()) {
         auto& wait_stop_id = wait_stop_id_opt.value();
         std::cout << ":-( " << wait_stop_id << '\n';
@@ -399,8 +532,8 @@ void process_route_query(const std::string& line, state_t& state) {
 
     // At this point the sequence itself is fully correct, and we may try to find appropriate ticket set.
     // Firstly, retrieve the interval of the route, and duration thereof.
-    auto first_departure_time = std::get<_stop_time>(tramlines.at(lines_seq.front()).at(stops_seq.front())),
-            last_arrival_time = std::get<_stop_time>(tramlines.at(lines_seq.back()).at(stops_seq.back()));
+    auto first_departure_time = std::get<_departure_time>(legs.front()),
+            last_arrival_time = std::get<_arrival_time>(legs.back());
     auto dur = stop_time_diff(first_departure_time, last_arrival_time);
 
     // Then, find the appropriate ticket set.
@@ -0,0 +1,47 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Run the command given as arguments with stdout/stderr discarded, and print its exit code, wall time in seconds and
+// peak RSS in KiB. The perf check spawns kasa through this, since the peak RSS of a process also covers the memory it
+// had before exec, i.e. that inherited from its parent; this one is small enough to stay below anything kasa uses.
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s command [args...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const pid_t pid = fork();
+    if (pid < 0) {
+        std::perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+        const int devnull = open("/dev/null", O_WRONLY);
+        if (devnull < 0) {
+            std::perror("open");
+            _exit(127);
+        }
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+        execv(argv[1], argv + 1);
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage {};
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        std::perror("wait4");
+        return EXIT_FAILURE;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    const int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    std::printf("%d %.6f %ld\n", exit_code, elapsed.count(), usage.ru_maxrss);
+    return EXIT_SUCCESS;
+}